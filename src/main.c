@@ -5,6 +5,7 @@
 #include <raylib.h>
 #include <pthread.h>
 
+#include "neighbour_list.h"
 #include "quadtree.h"
 #include "util.h"
 
@@ -35,18 +36,29 @@
 #define TARGET_FPS 60
 #define FIXED_UPDATE 1 // boolean
 #define THREAD_COUNT 8
+#define QT_AUTO_EXPAND 1 // boolean
+#define NEIGHBOUR_LISTS 1 // boolean
+#define NEIGHBOUR_SKIN (ENTITY_RADIUS * 4)
+#define SPATIAL_PARTITION 1 // boolean
 
 #define TARGET_DELTA (1.0 / TARGET_FPS)
 
 typedef void (*QTreeIntersectsFunc)(const QuadTree *, const Entity *, DynamicArray *);
 
+typedef bool (*EntityIntersectsFunc)(const Entity *, const Entity *);
+
 typedef struct PhysicsUpdateArgs {
 	const QuadTree *qtree;
 	const Entity *entities;
 	Entity *entities_future;
+	const uint *indices;
 	uint entity_count;
 	float delta_time;
 	QTreeIntersectsFunc intersect_func;
+	NeighbourList *neighbour_list;
+	bool rebuild_neighbour_list;
+	QuadTreeNearFunc near_func;
+	EntityIntersectsFunc entity_intersect_func;
 } PhysicsUpdateArgs;
 
 void *update_physics(void *args) {
@@ -54,8 +66,24 @@ void *update_physics(void *args) {
 	DynamicArray intersecting;
 	dynamic_array_init(&intersecting);
 
+	// fall back to querying the tree if the neighbour list couldn't be built
+	const bool use_neighbour_list = NEIGHBOUR_LISTS && (
+		!_args->rebuild_neighbour_list ||
+		neighbour_list_build(_args->neighbour_list, _args->qtree, _args->entities, _args->indices, _args->entity_count, _args->near_func)
+	);
 	for (int i = 0; i < _args->entity_count; ++i) {
-		_args->intersect_func(_args->qtree, &_args->entities[i], &intersecting);
+		const uint index = _args->indices[i];
+		if (use_neighbour_list) {
+			uint neighbour_count;
+			void **neighbours = neighbour_list_get_neighbours(_args->neighbour_list, i, &neighbour_count);
+			for (int j = 0; j < neighbour_count; ++j) {
+				if (_args->entity_intersect_func(&_args->entities[index], neighbours[j])) {
+					dynamic_array_push_back(&intersecting, neighbours[j]);
+				}
+			}
+		} else {
+			_args->intersect_func(_args->qtree, &_args->entities[index], &intersecting);
+		}
 		if (intersecting.size > 0) {
 			Vec2 relative_velocity;
 			Vec2 collision_position_sum = VEC2_ZERO;
@@ -63,12 +91,12 @@ void *update_physics(void *args) {
 			for (int j = 0; j < intersecting.size; ++j) {
 				Entity *intersecting_entity = intersecting.array[j];
 				collision_position_sum = vec2_add(&collision_position_sum, &intersecting_entity->position);
-				relative_velocity = vec2_subtract(&intersecting_entity->velocity, &_args->entities[i].velocity);
+				relative_velocity = vec2_subtract(&intersecting_entity->velocity, &_args->entities[index].velocity);
 				relative_velocity_sum = vec2_add(&relative_velocity_sum, &relative_velocity);
 			}
 			relative_velocity = vec2_divide(&relative_velocity_sum, intersecting.size);
 			Vec2 collision_position = vec2_divide(&collision_position_sum, intersecting.size);
-			Vec2 position_difference = vec2_subtract(&collision_position, &_args->entities[i].position);
+			Vec2 position_difference = vec2_subtract(&collision_position, &_args->entities[index].position);
 			if (vec2_dot_product(&position_difference, &relative_velocity) < 0) {
 				Vec2 tangent_vector = {
 					.x = -position_difference.y,
@@ -78,12 +106,12 @@ void *update_physics(void *args) {
 				float length = vec2_dot_product(&relative_velocity, &tangent_vector);
 				Vec2 velocity_on_tangent = vec2_multiply(&tangent_vector, length);
 				Vec2 velocity_perpendicular_to_tangent = vec2_subtract(&relative_velocity, &velocity_on_tangent);
-				_args->entities_future[i].velocity.x += velocity_perpendicular_to_tangent.x;
-				_args->entities_future[i].velocity.y += velocity_perpendicular_to_tangent.y;
+				_args->entities_future[index].velocity.x += velocity_perpendicular_to_tangent.x;
+				_args->entities_future[index].velocity.y += velocity_perpendicular_to_tangent.y;
 			}
 		}
-		_args->entities_future[i].position.x += _args->entities_future[i].velocity.x * _args->delta_time;
-		_args->entities_future[i].position.y += _args->entities_future[i].velocity.y * _args->delta_time;
+		_args->entities_future[index].position.x += _args->entities_future[index].velocity.x * _args->delta_time;
+		_args->entities_future[index].position.y += _args->entities_future[index].velocity.y * _args->delta_time;
 		dynamic_array_clear(&intersecting);
 	}
 	dynamic_array_free(&intersecting);
@@ -99,6 +127,7 @@ int main(void) {
 		printf("ERROR: Failed to create quadtree!\n");
 		return 1;
 	}
+	quadtree_set_auto_expand(qtree, QT_AUTO_EXPAND);
 
 	srand(time(0));
 	Vec2 start_positions[ENTITY_COUNT];
@@ -111,6 +140,10 @@ int main(void) {
 	Entity entities_rect_start[ENTITY_COUNT];
 	pthread_t pthreads[THREAD_COUNT];
 	PhysicsUpdateArgs *physics_args[THREAD_COUNT];
+	NeighbourList *neighbour_lists[THREAD_COUNT];
+	QuadTreePartition *partition;
+	const uint *thread_indices[THREAD_COUNT];
+	uint thread_entity_count[THREAD_COUNT];
 	int i, j, k;
 
 #if RANDOM
@@ -126,11 +159,13 @@ int main(void) {
 		entities_circle[i] = (Entity){
 			.position = start_positions[i],
 			.velocity = start_velocities[i],
+			.type = SHAPE_CIRCLE,
 			.shape.circle.radius = ENTITY_RADIUS,
 		};
 		entities_rect[i] = (Entity){
 			.position = start_positions[i],
 			.velocity = start_velocities[i],
+			.type = SHAPE_RECT,
 			.shape.rect.width = ENTITY_RADIUS * 2,
 			.shape.rect.height = ENTITY_RADIUS * 2,
 		};
@@ -191,9 +226,29 @@ int main(void) {
 	char entity_count_str[32];
 	char fps_str[32];
 	char frame_time_str[32];
+	char memory_str[48];
 
 	float delta_time = TARGET_DELTA;
 
+	for (i = 0; i < THREAD_COUNT; ++i) {
+		neighbour_lists[i] = neighbour_list_new(NEIGHBOUR_SKIN);
+		if (neighbour_lists[i] == NULL) {
+			printf("ERROR: Failed to create neighbour list!\n");
+			return 1;
+		}
+	}
+	partition = quadtree_partition_new(ENTITY_COUNT);
+	if (partition == NULL) {
+		printf("ERROR: Failed to create partition!\n");
+		return 1;
+	}
+	// start out with contiguous index ranges, the spatial partition
+	// replaces them whenever the tree is rebuilt
+	for (i = 0; i < THREAD_COUNT; ++i) {
+		thread_indices[i] = quadtree_partition_get_range(partition, i, THREAD_COUNT, &thread_entity_count[i]);
+	}
+	uint entities_in_qtree = 0;
+
 	SetConfigFlags(FLAG_MSAA_4X_HINT);
 	InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, WINDOW_TITLE);
 #if FIXED_UPDATE
@@ -201,14 +256,30 @@ int main(void) {
 #endif
 
 	while (!WindowShouldClose()) {
-		uint entities_in_qtree;
-		quadtree_clear(qtree);
+		bool rebuild = !NEIGHBOUR_LISTS;
 #if TEST_TYPE == TEST_RECTS
 		if (IsKeyPressed(KEY_SPACE)) {
 			memcpy(entities_rect, entities_rect_start, sizeof(Entity) * ENTITY_COUNT);
 			memcpy(entities_rect_future, entities_rect_start, sizeof(Entity) * ENTITY_COUNT);
 		}
-		entities_in_qtree = quadtree_add_entities_rect(qtree, entities_rect, ENTITY_COUNT);
+		for (i = 0; i < THREAD_COUNT && !rebuild; ++i) {
+			rebuild = neighbour_list_needs_rebuild(
+				neighbour_lists[i],
+				entities_rect,
+				thread_indices[i],
+				thread_entity_count[i]
+			);
+		}
+		if (rebuild) {
+			quadtree_clear(qtree);
+			entities_in_qtree = quadtree_add_entities(qtree, entities_rect, ENTITY_COUNT, NULL);
+#if SPATIAL_PARTITION
+			quadtree_partition_entities(qtree, partition, entities_rect);
+			for (i = 0; i < THREAD_COUNT; ++i) {
+				thread_indices[i] = quadtree_partition_get_range(partition, i, THREAD_COUNT, &thread_entity_count[i]);
+			}
+#endif
+		}
 		for (i = 0; i < THREAD_COUNT; ++i) {
 			physics_args[i] = malloc(sizeof(PhysicsUpdateArgs));
 			if (physics_args[i] == NULL) {
@@ -216,11 +287,16 @@ int main(void) {
 			}
 			*physics_args[i] = (PhysicsUpdateArgs){
 				.qtree = qtree,
-				.entities = &entities_rect[ENTITY_COUNT / THREAD_COUNT * i],
-				.entities_future = &entities_rect_future[ENTITY_COUNT / THREAD_COUNT * i],
-				.entity_count = ENTITY_COUNT / THREAD_COUNT,
+				.entities = entities_rect,
+				.entities_future = entities_rect_future,
+				.indices = thread_indices[i],
+				.entity_count = thread_entity_count[i],
 				.delta_time = delta_time,
-				.intersect_func = quadtree_entities_rect_intersecting_entity_rect,
+				.intersect_func = quadtree_entities_intersecting_entity,
+				.neighbour_list = neighbour_lists[i],
+				.rebuild_neighbour_list = rebuild,
+				.near_func = quadtree_entities_near_entity,
+				.entity_intersect_func = entity_intersects_entity,
 			};
 			pthread_create(&pthreads[i], NULL, update_physics, physics_args[i]);
 		}
@@ -244,9 +320,11 @@ int main(void) {
 		sprintf(entity_count_str, "entities: %d", entities_in_qtree);
 		sprintf(fps_str, "fps: %d", GetFPS());
 		sprintf(frame_time_str, "frame time: %f", GetFrameTime());
+		sprintf(memory_str, "tree memory: %zu KB", quadtree_get_memory_usage(qtree) / 1024);
 		DrawText(entity_count_str, 0, 0, FONT_SIZE, WHITE);
 		DrawText(fps_str, 0, FONT_SIZE, FONT_SIZE, WHITE);
 		DrawText(frame_time_str, 0, FONT_SIZE * 2, FONT_SIZE, WHITE);
+		DrawText(memory_str, 0, FONT_SIZE * 3, FONT_SIZE, WHITE);
 		EndDrawing();
 
 #elif TEST_TYPE == TEST_CIRCLES
@@ -254,7 +332,24 @@ int main(void) {
 			memcpy(entities_circle, entities_circle_start, sizeof(Entity) * ENTITY_COUNT);
 			memcpy(entities_circle_future, entities_circle_start, sizeof(Entity) * ENTITY_COUNT);
 		}
-		entities_in_qtree = quadtree_add_entities_circle(qtree, entities_circle, ENTITY_COUNT);
+		for (i = 0; i < THREAD_COUNT && !rebuild; ++i) {
+			rebuild = neighbour_list_needs_rebuild(
+				neighbour_lists[i],
+				entities_circle,
+				thread_indices[i],
+				thread_entity_count[i]
+			);
+		}
+		if (rebuild) {
+			quadtree_clear(qtree);
+			entities_in_qtree = quadtree_add_entities(qtree, entities_circle, ENTITY_COUNT, NULL);
+#if SPATIAL_PARTITION
+			quadtree_partition_entities(qtree, partition, entities_circle);
+			for (i = 0; i < THREAD_COUNT; ++i) {
+				thread_indices[i] = quadtree_partition_get_range(partition, i, THREAD_COUNT, &thread_entity_count[i]);
+			}
+#endif
+		}
 		for (i = 0; i < THREAD_COUNT; ++i) {
 			physics_args[i] = malloc(sizeof(PhysicsUpdateArgs));
 			if (physics_args[i] == NULL) {
@@ -262,11 +357,16 @@ int main(void) {
 			}
 			*physics_args[i] = (PhysicsUpdateArgs){
 				.qtree = qtree,
-				.entities = &entities_circle[ENTITY_COUNT / THREAD_COUNT * i],
-				.entities_future = &entities_circle_future[ENTITY_COUNT / THREAD_COUNT * i],
-				.entity_count = ENTITY_COUNT / THREAD_COUNT,
+				.entities = entities_circle,
+				.entities_future = entities_circle_future,
+				.indices = thread_indices[i],
+				.entity_count = thread_entity_count[i],
 				.delta_time = delta_time,
-				.intersect_func = quadtree_entities_circle_intersecting_entity_circle,
+				.intersect_func = quadtree_entities_intersecting_entity,
+				.neighbour_list = neighbour_lists[i],
+				.rebuild_neighbour_list = rebuild,
+				.near_func = quadtree_entities_near_entity,
+				.entity_intersect_func = entity_intersects_entity,
 			};
 			pthread_create(&pthreads[i], NULL, update_physics, physics_args[i]);
 		}
@@ -294,14 +394,20 @@ int main(void) {
 		sprintf(entity_count_str, "entities: %d", entities_in_qtree);
 		sprintf(fps_str, "fps: %d", GetFPS());
 		sprintf(frame_time_str, "frame time: %f", GetFrameTime());
+		sprintf(memory_str, "tree memory: %zu KB", quadtree_get_memory_usage(qtree) / 1024);
 		DrawText(entity_count_str, 0, 0, FONT_SIZE, WHITE);
 		DrawText(fps_str, 0, FONT_SIZE, FONT_SIZE, WHITE);
 		DrawText(frame_time_str, 0, FONT_SIZE * 2, FONT_SIZE, WHITE);
+		DrawText(memory_str, 0, FONT_SIZE * 3, FONT_SIZE, WHITE);
 		EndDrawing();
 #endif
 	}
 
 	CloseWindow();
+	for (i = 0; i < THREAD_COUNT; ++i) {
+		neighbour_list_free(neighbour_lists[i]);
+	}
+	quadtree_partition_free(partition);
 	quadtree_free(qtree);
 	return 0;
 }
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+
+#include "neighbour_list.h"
+#include "quadtree.h"
+#include "util.h"
+
+// Caches every entity within skin of each entity's shape so the exact tests
+// can run over the cached lists until some entity has moved more than half
+// the skin since the last build. List slots follow the order of the indices
+// the list was built with
+struct NeighbourList {
+	float skin;
+	uint count;
+	uint capacity;
+	Vec2 *positions;
+	uint *offsets;
+	DynamicArray neighbours;
+};
+
+NeighbourList *neighbour_list_new(float skin) {
+	NeighbourList *list = malloc(sizeof(*list));
+	if (list == NULL) {
+		return NULL;
+	}
+	if (!dynamic_array_init(&list->neighbours)) {
+		free(list);
+		return NULL;
+	}
+	list->skin = skin;
+	list->count = 0;
+	list->capacity = 0;
+	list->positions = NULL;
+	list->offsets = NULL;
+	return list;
+}
+
+void neighbour_list_free(NeighbourList *list) {
+	dynamic_array_free(&list->neighbours);
+	free(list->positions);
+	free(list->offsets);
+	free(list);
+}
+
+bool neighbour_list_build(NeighbourList *list, const QuadTree *qtree, const Entity *entities, const uint *indices, uint count, QuadTreeNearFunc near_func) {
+	if (count > list->capacity) {
+		// on failure the list is left empty so it reports that it needs a rebuild
+		list->count = 0;
+		Vec2 *new_positions = realloc(list->positions, sizeof(*new_positions) * count);
+		if (new_positions == NULL) {
+			return false;
+		}
+		list->positions = new_positions;
+		uint *new_offsets = realloc(list->offsets, sizeof(*new_offsets) * (count + 1));
+		if (new_offsets == NULL) {
+			return false;
+		}
+		list->offsets = new_offsets;
+		list->capacity = count;
+	}
+	list->count = count;
+	dynamic_array_clear(&list->neighbours);
+	list->offsets[0] = 0;
+	for (int i = 0; i < count; ++i) {
+		const Entity *entity = &entities[indices[i]];
+		list->positions[i] = entity->position;
+		near_func(qtree, entity, list->skin, &list->neighbours);
+		list->offsets[i + 1] = list->neighbours.size;
+	}
+	return true;
+}
+
+bool neighbour_list_needs_rebuild(const NeighbourList *list, const Entity *entities, const uint *indices, uint count) {
+	if (count != list->count) {
+		return true;
+	}
+	const float max_displacement = list->skin / 2;
+	for (int i = 0; i < count; ++i) {
+		Vec2 displacement = vec2_subtract(&entities[indices[i]].position, &list->positions[i]);
+		if (vec2_magnitude_squared(&displacement) > max_displacement * max_displacement) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void **neighbour_list_get_neighbours(const NeighbourList *list, uint index, uint *count) {
+	*count = list->offsets[index + 1] - list->offsets[index];
+	return &list->neighbours.array[list->offsets[index]];
+}
@@ -0,0 +1,21 @@
+#ifndef NEIGHBOUR_LIST_H
+#define NEIGHBOUR_LIST_H
+
+#include "quadtree.h"
+#include "util.h"
+
+typedef struct NeighbourList NeighbourList;
+
+typedef void (*QuadTreeNearFunc)(const QuadTree *, const Entity *, float, DynamicArray *);
+
+NeighbourList *neighbour_list_new(float skin);
+
+void neighbour_list_free(NeighbourList *list);
+
+bool neighbour_list_build(NeighbourList *list, const QuadTree *qtree, const Entity *entities, const uint *indices, uint count, QuadTreeNearFunc near_func);
+
+bool neighbour_list_needs_rebuild(const NeighbourList *list, const Entity *entities, const uint *indices, uint count);
+
+void **neighbour_list_get_neighbours(const NeighbourList *list, uint index, uint *count);
+
+#endif
@@ -1,30 +1,115 @@
 #include <assert.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "quadtree.h"
 #include "util.h"
 
 #define QT_DEFAULT_CAPACITY 8
 #define QT_NODE_CAPACITY 10
+#define QT_MAX_GROWTH 32
+#define QT_PARTITION_BITS 16
+
+// Compact node layout. Nodes don't store their boundary, it is derived from
+// the root while descending. Each slot holds the entity's bounds as 16-bit
+// fixed point relative to the node's cell and a 32-bit index into the tree's
+// entity table, so candidates that fail the quantized test are rejected
+// without loading their Entity
+#ifndef QT_QUANTIZED
+#define QT_QUANTIZED 0
+#endif
+
+#define QT_QUANTIZED_MAX UINT16_MAX
 
 typedef struct {
-	uint entity_count;
+	uint16_t min_x;
+	uint16_t min_y;
+	uint16_t max_x;
+	uint16_t max_y;
+} QuantizedAABB;
+
+// Entities are grouped by shape inside a node so a query can run one narrow
+// test over each group without branching per entity. Rects fill the entity
+// slots from the front and circles from the back
+#if QT_QUANTIZED
+typedef struct {
+	uint16_t rect_count;
+	uint16_t circle_count;
+	// children are always allocated as four consecutive nodes
+	int first_child;
+	QuantizedAABB entity_bounds[QT_NODE_CAPACITY];
+	uint32_t entities[QT_NODE_CAPACITY];
+} QuadTreeNode;
+#else
+typedef struct {
+	uint rect_count;
+	uint circle_count;
 	AABB boundary;
 	void *entities[QT_NODE_CAPACITY];
 	int child_indices[4];
 } QuadTreeNode;
+#endif
 
 struct QuadTree {
 	uint size;
 	uint capacity;
+	bool auto_expand;
+	AABB initial_boundary;
+	AABB boundary;
 	QuadTreeNode *nodes;
+#if QT_QUANTIZED
+	// entity pointers in insertion order, only read for candidates that
+	// pass the quantized test
+	DynamicArray entity_table;
+#endif
 };
 
 void quadtree_node_init(QuadTreeNode *node, const AABB *boundary) {
-	node->entity_count = 0;
+	node->rect_count = 0;
+	node->circle_count = 0;
+#if QT_QUANTIZED
+	node->first_child = -1;
+#else
 	node->boundary = *boundary;
 	node->child_indices[0] = -1;
+#endif
+}
+
+// Returns -1 for every quadrant of a leaf
+int quadtree_node_get_child(const QuadTreeNode *node, int quadrant) {
+#if QT_QUANTIZED
+	return node->first_child < 0 ? -1 : node->first_child + quadrant;
+#else
+	return node->child_indices[quadrant];
+#endif
+}
+
+void quadtree_node_set_children(QuadTreeNode *node, int first_child) {
+#if QT_QUANTIZED
+	node->first_child = first_child;
+#else
+	for (int i = 0; i < 4; ++i) {
+		node->child_indices[i] = first_child + i;
+	}
+#endif
+}
+
+// quadrant 0 is top left, 1 top right, 2 bottom left, 3 bottom right
+AABB aabb_get_quadrant(const AABB *aabb, int quadrant) {
+	Vec2 center = aabb_get_center(aabb);
+	return (AABB){
+		.min = {
+			.x = (quadrant & 1) ? center.x : aabb->min.x,
+			.y = (quadrant & 2) ? center.y : aabb->min.y,
+		},
+		.max = {
+			.x = (quadrant & 1) ? aabb->max.x : center.x,
+			.y = (quadrant & 2) ? aabb->max.y : center.y,
+		},
+	};
 }
 
 QuadTree* quadtree_new(const AABB *boundary) {
@@ -40,17 +125,43 @@ QuadTree* quadtree_new(const AABB *boundary) {
 	}
 	qtree->size = 1;
 	qtree->capacity = QT_DEFAULT_CAPACITY;
+	qtree->auto_expand = false;
+	qtree->initial_boundary = *boundary;
+	qtree->boundary = *boundary;
 	qtree->nodes = nodes;
+#if QT_QUANTIZED
+	if (!dynamic_array_init(&qtree->entity_table)) {
+		free(nodes);
+		free(qtree);
+		return NULL;
+	}
+#endif
 	quadtree_node_init(&qtree->nodes[0], boundary);
 	return qtree;
 }
 
+AABB quadtree_node_get_child_boundary(const QuadTree *qtree, const QuadTreeNode *node, const AABB *boundary, int quadrant) {
+#if QT_QUANTIZED
+	return aabb_get_quadrant(boundary, quadrant);
+#else
+	return qtree->nodes[node->child_indices[quadrant]].boundary;
+#endif
+}
+
+// Drops any growth too, so a few outliers only widen the root until they are gone
 void quadtree_clear(QuadTree *qtree) {
 	qtree->size = 1;
-	quadtree_node_init(&qtree->nodes[0], &qtree->nodes[0].boundary);
+	qtree->boundary = qtree->initial_boundary;
+	quadtree_node_init(&qtree->nodes[0], &qtree->boundary);
+#if QT_QUANTIZED
+	dynamic_array_clear(&qtree->entity_table);
+#endif
 }
 
 void quadtree_free(QuadTree *qtree) {
+#if QT_QUANTIZED
+	dynamic_array_free(&qtree->entity_table);
+#endif
 	free(qtree->nodes);
 	free(qtree);
 }
@@ -59,6 +170,22 @@ uint quadtree_get_size(QuadTree *qtree) {
 	return qtree->size;
 }
 
+AABB quadtree_get_boundary(const QuadTree *qtree) {
+	return qtree->boundary;
+}
+
+void quadtree_set_auto_expand(QuadTree *qtree, bool auto_expand) {
+	qtree->auto_expand = auto_expand;
+}
+
+size_t quadtree_get_memory_usage(const QuadTree *qtree) {
+	size_t usage = sizeof(*qtree) + sizeof(*qtree->nodes) * qtree->capacity;
+#if QT_QUANTIZED
+	usage += sizeof(*qtree->entity_table.array) * qtree->entity_table.capacity;
+#endif
+	return usage;
+}
+
 typedef bool IntersectsFunc(const void *, const void *);
 
 bool _aabb_intersects_entity_rect(const void *aabb, const void *entity_rect) {
@@ -77,112 +204,414 @@ bool _entity_rect_intersects_entity_rect(const void *entity_rect_1, const void *
 	return entity_rect_intersects_entity_rect(entity_rect_1, entity_rect_2);
 }
 
-bool quadtree_node_add_entity(QuadTree *qtree, int index, Entity *entity, IntersectsFunc node_intersects_entity) {
+bool _entity_circle_intersects_entity_rect(const void *entity_circle, const void *entity_rect) {
+	return entity_circle_intersects_entity_rect(entity_circle, entity_rect);
+}
+
+bool _entity_rect_intersects_entity_circle(const void *entity_rect, const void *entity_circle) {
+	return entity_circle_intersects_entity_rect(entity_circle, entity_rect);
+}
+
+IntersectsFunc *const node_intersects_entity_funcs[SHAPE_COUNT] = {
+	[SHAPE_RECT] = _aabb_intersects_entity_rect,
+	[SHAPE_CIRCLE] = _aabb_intersects_entity_circle,
+};
+
+// indexed by query shape then by the shape of the entity it is tested against
+IntersectsFunc *const entity_intersects_entity_funcs[SHAPE_COUNT][SHAPE_COUNT] = {
+	[SHAPE_RECT] = {
+		[SHAPE_RECT] = _entity_rect_intersects_entity_rect,
+		[SHAPE_CIRCLE] = _entity_rect_intersects_entity_circle,
+	},
+	[SHAPE_CIRCLE] = {
+		[SHAPE_RECT] = _entity_circle_intersects_entity_rect,
+		[SHAPE_CIRCLE] = _entity_circle_intersects_entity_circle,
+	},
+};
+
+#if QT_QUANTIZED
+uint16_t quantize_floor(float value) {
+	return clamp_float(floorf(value), 0, QT_QUANTIZED_MAX);
+}
+
+uint16_t quantize_ceil(float value) {
+	return clamp_float(ceilf(value), 0, QT_QUANTIZED_MAX);
+}
+
+// Rounds outwards so the quantized bounds always contain the part of the
+// float bounds that lies inside the cell. Queries pad by one more unit since
+// cells derived from a grown root can differ from the ones entities were
+// quantized against by a rounding error
+QuantizedAABB quantized_aabb_from_aabb(const AABB *cell, const AABB *aabb, float padding) {
+	const float scale_x = QT_QUANTIZED_MAX / (cell->max.x - cell->min.x);
+	const float scale_y = QT_QUANTIZED_MAX / (cell->max.y - cell->min.y);
+	return (QuantizedAABB){
+		.min_x = quantize_floor((aabb->min.x - cell->min.x) * scale_x - padding),
+		.min_y = quantize_floor((aabb->min.y - cell->min.y) * scale_y - padding),
+		.max_x = quantize_ceil((aabb->max.x - cell->min.x) * scale_x + padding),
+		.max_y = quantize_ceil((aabb->max.y - cell->min.y) * scale_y + padding),
+	};
+}
+
+// Inclusive on purpose, this may report false positives but never false negatives
+bool quantized_aabb_intersects_quantized_aabb(const QuantizedAABB *a, const QuantizedAABB *b) {
+	return (a->max_x >= b->min_x && a->min_x <= b->max_x &&
+			a->max_y >= b->min_y && a->min_y <= b->max_y);
+}
+#endif
+
+bool quadtree_reserve_children(QuadTree *qtree) {
+	if (qtree->size <= qtree->capacity - 4) {
+		return true;
+	}
+	// realloc the nodes to fit more entities (double capacity)
+	QuadTreeNode *new_nodes = realloc(
+		qtree->nodes, sizeof(*new_nodes) * qtree->capacity * 2
+	);
+	if (new_nodes == NULL) {
+		printf("ERROR: Failed to allocate new memory! Can't add point!\n");
+		return false;
+	}
+	qtree->nodes = new_nodes;
+	qtree->capacity *= 2;
+	printf("QuadTree node capacity doubled to: %d nodes\n", qtree->capacity);
+	return true;
+}
+
+// Doubles the boundary towards the sides the aabb sticks out of the most
+AABB aabb_get_grown(const AABB *boundary, const AABB *towards) {
+	const bool grow_left = boundary->min.x - towards->min.x > towards->max.x - boundary->max.x;
+	const bool grow_up = boundary->min.y - towards->min.y > towards->max.y - boundary->max.y;
+	const float width = boundary->max.x - boundary->min.x;
+	const float height = boundary->max.y - boundary->min.y;
+	return (AABB){
+		.min = {
+			.x = grow_left ? boundary->min.x - width : boundary->min.x,
+			.y = grow_up ? boundary->min.y - height : boundary->min.y,
+		},
+		.max = {
+			.x = grow_left ? boundary->max.x : boundary->max.x + width,
+			.y = grow_up ? boundary->max.y : boundary->max.y + height,
+		},
+	};
+}
+
+// Returns how many times the root has to grow to contain the aabb, or -1 if
+// it can't within QT_MAX_GROWTH doublings or the boundary would overflow
+int quadtree_get_growth_count(const QuadTree *qtree, const AABB *aabb) {
+	AABB boundary = qtree->boundary;
+	for (int i = 0; i <= QT_MAX_GROWTH; ++i) {
+		if (aabb_contains_aabb(&boundary, aabb)) {
+			return i;
+		}
+		boundary = aabb_get_grown(&boundary, aabb);
+		if (!aabb_is_finite(&boundary)) {
+			return -1;
+		}
+	}
+	return -1;
+}
+
+// Grows the root once with aabb_get_grown. The old root is moved into the
+// matching quadrant of the new root so its subtree is reused as is
+bool quadtree_grow(QuadTree *qtree, const AABB *towards) {
+	if (!quadtree_reserve_children(qtree)) {
+		return false;
+	}
+	const AABB old_boundary = qtree->boundary;
+	const AABB new_boundary = aabb_get_grown(&old_boundary, towards);
+	const bool grow_left = new_boundary.min.x < old_boundary.min.x;
+	const bool grow_up = new_boundary.min.y < old_boundary.min.y;
+	// split at the old root's corner so its quadrant matches it exactly
+	const Vec2 center = {
+		.x = grow_left ? old_boundary.min.x : old_boundary.max.x,
+		.y = grow_up ? old_boundary.min.y : old_boundary.max.y,
+	};
+	const int old_quadrant = grow_left | (grow_up << 1);
+	QuadTreeNode *root = &qtree->nodes[0];
+	for (int i = 0; i < 4; ++i) {
+		QuadTreeNode *child = &qtree->nodes[qtree->size + i];
+		if (i == old_quadrant) {
+			*child = *root;
+			continue;
+		}
+		quadtree_node_init(child, &(AABB){
+			.min = {
+				.x = (i & 1) ? center.x : new_boundary.min.x,
+				.y = (i & 2) ? center.y : new_boundary.min.y,
+			},
+			.max = {
+				.x = (i & 1) ? new_boundary.max.x : center.x,
+				.y = (i & 2) ? new_boundary.max.y : center.y,
+			},
+		});
+	}
+	quadtree_node_init(root, &new_boundary);
+	quadtree_node_set_children(root, qtree->size);
+	qtree->size += 4;
+	qtree->boundary = new_boundary;
+	return true;
+}
+
+bool quadtree_node_add_entity(QuadTree *qtree, int index, const AABB *boundary, Entity *entity, IntersectsFunc node_intersects_entity) {
 	QuadTreeNode *node = &qtree->nodes[index];
 
-	if (!node_intersects_entity(&node->boundary, entity)) {
+	if (!node_intersects_entity(boundary, entity)) {
 		return false;
 	}
-	if (node->entity_count < QT_NODE_CAPACITY) {
+	if (node->rect_count + node->circle_count < QT_NODE_CAPACITY) {
 		// we have room for more entities and no children yet
 		// assume if any child indices are invalid they all are
-		// so just add the entity here and increment entity count
-		node->entities[node->entity_count++] = entity;
-		return true;
-	}
-	if (node->child_indices[0] < 0 && qtree->size > qtree->capacity - 4) {
-		// realloc the nodes to fit more entities (double capacity)
-		QuadTreeNode *new_nodes = realloc(
-			qtree->nodes, sizeof(*new_nodes) * qtree->capacity * 2
-		);
-		if (new_nodes == NULL) {
-			printf("ERROR: Failed to allocate new memory! Can't add point!\n");
+		// so just add the entity to its shape's group here
+#if QT_QUANTIZED
+		if (!dynamic_array_push_back(&qtree->entity_table, entity)) {
 			return false;
 		}
-		qtree->nodes = new_nodes;
-		qtree->capacity *= 2;
-		node = &new_nodes[index];
-		printf("QuadTree node capacity doubled to: %d nodes\n", qtree->capacity);
+#endif
+		const uint slot = (entity->type == SHAPE_RECT)
+			? node->rect_count++
+			: QT_NODE_CAPACITY - ++node->circle_count;
+#if QT_QUANTIZED
+		const AABB entity_bounds = aabb_get_from_entity(entity);
+		node->entity_bounds[slot] = quantized_aabb_from_aabb(boundary, &entity_bounds, 0);
+		node->entities[slot] = qtree->entity_table.size - 1;
+#else
+		node->entities[slot] = entity;
+#endif
+		return true;
 	}
-	if (node->child_indices[0] < 0) {
+	if (quadtree_node_get_child(node, 0) < 0) {
 		// we don't have room for more entities and need to subdivide
+		if (!quadtree_reserve_children(qtree)) {
+			return false;
+		}
+		node = &qtree->nodes[index];
+		quadtree_node_set_children(node, qtree->size);
 		for (int i = 0; i < 4; ++i) {
-			node->child_indices[i] = qtree->size + i;
+			AABB child_boundary = aabb_get_quadrant(boundary, i);
+			quadtree_node_init(&qtree->nodes[qtree->size + i], &child_boundary);
 		}
-
-		Vec2 boundary_center = aabb_get_center(&node->boundary);
-
-		quadtree_node_init(&qtree->nodes[node->child_indices[0]], &(AABB){
-			.min = node->boundary.min,
-			.max = boundary_center,
-		});
-		quadtree_node_init(&qtree->nodes[node->child_indices[1]], &(AABB){
-			.min = {.x = boundary_center.x, .y = node->boundary.min.y},
-			.max = {.x = node->boundary.max.x, .y = boundary_center.y}
-		});
-		quadtree_node_init(&qtree->nodes[node->child_indices[2]], &(AABB){
-			.min = {.x = node->boundary.min.x, .y = boundary_center.y},
-			.max = {.x = boundary_center.x, .y = node->boundary.max.y}
-		});
-		quadtree_node_init(&qtree->nodes[node->child_indices[3]], &(AABB){
-			.min = boundary_center,
-			.max = node->boundary.max,
-		});
 		qtree->size += 4;
 	}
 	// add new entity to whichever child will accept it
 	// it should always be accepted unless something weird has happened
 	for (int i = 0; i < 4; ++i) {
-		if (quadtree_node_add_entity(qtree, node->child_indices[i], entity, node_intersects_entity)) return true;
+		AABB child_boundary = quadtree_node_get_child_boundary(qtree, node, boundary, i);
+		if (quadtree_node_add_entity(qtree, quadtree_node_get_child(node, i), &child_boundary, entity, node_intersects_entity)) return true;
 	}
 	printf("ERROR: Reached unreachable code!\n");
 	return false;
 }
 
-uint quadtree_add_entities_rect(QuadTree *qtree, Entity *rects, int count) {
+uint quadtree_add_entities(QuadTree *qtree, Entity *entities, int count, DynamicArray *rejected) {
 	uint entities_added = 0;
 	for (int i = 0; i < count; ++i) {
-		entities_added += quadtree_node_add_entity(qtree, 0, &rects[i], _aabb_intersects_entity_rect);
+		// untagged entities are rejected when asserts are compiled out
+		assert(shape_type_is_valid(entities[i].type));
+		if (!shape_type_is_valid(entities[i].type)) {
+			if (rejected != NULL) {
+				dynamic_array_push_back(rejected, &entities[i]);
+			}
+			continue;
+		}
+		IntersectsFunc *node_intersects_entity = node_intersects_entity_funcs[entities[i].type];
+		bool added = true;
+		const AABB aabb = aabb_get_from_entity(&entities[i]);
+		if (qtree->auto_expand && aabb_is_finite(&aabb)) {
+			// work out the growth first so an entity the root can't reach is
+			// rejected without leaving the tree any deeper
+			const int growth_count = quadtree_get_growth_count(qtree, &aabb);
+			added = growth_count >= 0;
+			for (int j = 0; j < growth_count && added; ++j) {
+				added = quadtree_grow(qtree, &aabb);
+			}
+		}
+		added = added && quadtree_node_add_entity(qtree, 0, &qtree->boundary, &entities[i], node_intersects_entity);
+		if (added) {
+			entities_added++;
+		} else if (rejected != NULL) {
+			dynamic_array_push_back(rejected, &entities[i]);
+		}
 	}
 	return entities_added;
 }
 
-uint quadtree_add_entities_circle(QuadTree *qtree, Entity *circles, int count) {
-	uint entities_added = 0;
-	for (int i = 0; i < count; ++i) {
-		entities_added += quadtree_node_add_entity(qtree, 0, &circles[i], _aabb_intersects_entity_circle);
+void quadtree_node_entities_in_group_intersecting_entity(const QuadTree *qtree, const QuadTreeNode *node, uint first, uint last, const Entity *entity, const QuantizedAABB *quantized_bounds, const Entity *exclude, DynamicArray *results, IntersectsFunc entity_intersects_entity) {
+	for (int i = first; i < last; ++i) {
+#if QT_QUANTIZED
+		if (!quantized_aabb_intersects_quantized_aabb(quantized_bounds, &node->entity_bounds[i])) {
+			continue;
+		}
+		Entity *other = qtree->entity_table.array[node->entities[i]];
+#else
+		Entity *other = node->entities[i];
+#endif
+		if (exclude == other) {
+			continue;
+		}
+		if (entity_intersects_entity(entity, other)) {
+			dynamic_array_push_back(results, other);
+		}
 	}
-	return entities_added;
 }
 
-void quadtree_node_entities_intersecting_entity(const QuadTree *qtree, int index, const Entity *entity, DynamicArray *results, IntersectsFunc node_intersects_entity, IntersectsFunc entity_intersects_entity) {
+void quadtree_node_entities_intersecting_entity(const QuadTree *qtree, int index, const AABB *boundary, const Entity *entity, const AABB *entity_bounds, const Entity *exclude, DynamicArray *results, IntersectsFunc node_intersects_entity, IntersectsFunc intersects_rect, IntersectsFunc intersects_circle) {
 	QuadTreeNode *node = &qtree->nodes[index];
-	if (node->entity_count == 0) {
+	if (node->rect_count + node->circle_count == 0 && quadtree_node_get_child(node, 0) < 0) {
+		// a grown root can be empty and still have children
 		return;
 	}
-	if (!node_intersects_entity(&node->boundary, entity)) {
+	if (!node_intersects_entity(boundary, entity)) {
 		return;
 	}
-	for (int i = 0; i < node->entity_count; ++i) {
-		if (entity == node->entities[i]) {
-			continue;
-		}
-		if (entity_intersects_entity(entity, node->entities[i])) {
-			dynamic_array_push_back(results, node->entities[i]);
-		}
-	}
-	if (node->child_indices[0] < 0) {
+	QuantizedAABB quantized_bounds;
+#if QT_QUANTIZED
+	quantized_bounds = quantized_aabb_from_aabb(boundary, entity_bounds, 1);
+#endif
+	quadtree_node_entities_in_group_intersecting_entity(qtree, node, 0, node->rect_count, entity, &quantized_bounds, exclude, results, intersects_rect);
+	quadtree_node_entities_in_group_intersecting_entity(qtree, node, QT_NODE_CAPACITY - node->circle_count, QT_NODE_CAPACITY, entity, &quantized_bounds, exclude, results, intersects_circle);
+	if (quadtree_node_get_child(node, 0) < 0) {
 		return;
 	}
 	for (int i = 0; i < 4; ++i) {
-		quadtree_node_entities_intersecting_entity(qtree, node->child_indices[i], entity, results, node_intersects_entity, entity_intersects_entity);
+		AABB child_boundary = quadtree_node_get_child_boundary(qtree, node, boundary, i);
+		quadtree_node_entities_intersecting_entity(qtree, quadtree_node_get_child(node, i), &child_boundary, entity, entity_bounds, exclude, results, node_intersects_entity, intersects_rect, intersects_circle);
 	}
 }
 
-void quadtree_entities_rect_intersecting_entity_rect(const QuadTree *qtree, const Entity *rect, DynamicArray *results) {
-	quadtree_node_entities_intersecting_entity(qtree, 0, rect, results, _aabb_intersects_entity_rect, _entity_rect_intersects_entity_rect);
+void quadtree_entities_intersecting_shape(const QuadTree *qtree, const Entity *entity, const Entity *exclude, DynamicArray *results) {
+	// untagged entities match nothing when asserts are compiled out
+	assert(shape_type_is_valid(entity->type));
+	if (!shape_type_is_valid(entity->type)) {
+		return;
+	}
+	const AABB entity_bounds = aabb_get_from_entity(entity);
+	quadtree_node_entities_intersecting_entity(
+		qtree, 0, &qtree->boundary, entity, &entity_bounds, exclude, results,
+		node_intersects_entity_funcs[entity->type],
+		entity_intersects_entity_funcs[entity->type][SHAPE_RECT],
+		entity_intersects_entity_funcs[entity->type][SHAPE_CIRCLE]
+	);
+}
+
+void quadtree_entities_intersecting_entity(const QuadTree *qtree, const Entity *entity, DynamicArray *results) {
+	quadtree_entities_intersecting_shape(qtree, entity, entity, results);
+}
+
+void quadtree_entities_near_entity(const QuadTree *qtree, const Entity *entity, float margin, DynamicArray *results) {
+	assert(shape_type_is_valid(entity->type));
+	Entity inflated = *entity;
+	switch (entity->type) {
+	case SHAPE_RECT:
+		inflated.shape.rect.width += margin * 2;
+		inflated.shape.rect.height += margin * 2;
+		break;
+	case SHAPE_CIRCLE:
+		inflated.shape.circle.radius += margin;
+		break;
+	case SHAPE_NONE:
+	case SHAPE_COUNT:
+		break;
+	}
+	quadtree_entities_intersecting_shape(qtree, &inflated, entity, results);
+}
+
+// Entities are sorted by a Z-order code over the root using the same quadrant
+// layout as the nodes, so a contiguous run of the order covers whole subtrees
+// apart from the cells it starts and ends in
+struct QuadTreePartition {
+	uint entity_count;
+	uint64_t *keys;
+	uint64_t *scratch;
+	uint *order;
+};
+
+uint morton_interleave(uint x, uint y, uint depth) {
+	uint code = 0;
+	for (int i = 0; i < depth; ++i) {
+		code |= ((x >> i) & 1) << (2 * i);
+		code |= ((y >> i) & 1) << (2 * i + 1);
+	}
+	return code;
+}
+
+// Entities outside the root belong to the nearest border cell
+uint quadtree_partition_quantize(float value, float min, float max) {
+	const float cells_per_side = 1 << QT_PARTITION_BITS;
+	float cell = (value - min) / (max - min) * cells_per_side;
+	// NaN fails the comparison and ends up in the first cell
+	if (!(cell > 0)) {
+		return 0;
+	}
+	return cell < cells_per_side - 1 ? (uint)cell : (uint)cells_per_side - 1;
+}
+
+QuadTreePartition *quadtree_partition_new(uint entity_count) {
+	QuadTreePartition *partition = malloc(sizeof(*partition));
+	if (partition == NULL) {
+		return NULL;
+	}
+	partition->keys = malloc(sizeof(*partition->keys) * entity_count);
+	partition->scratch = malloc(sizeof(*partition->scratch) * entity_count);
+	partition->order = malloc(sizeof(*partition->order) * entity_count);
+	if (partition->keys == NULL || partition->scratch == NULL || partition->order == NULL) {
+		quadtree_partition_free(partition);
+		return NULL;
+	}
+	partition->entity_count = entity_count;
+	for (int i = 0; i < entity_count; ++i) {
+		partition->order[i] = i;
+	}
+	return partition;
+}
+
+void quadtree_partition_free(QuadTreePartition *partition) {
+	free(partition->keys);
+	free(partition->scratch);
+	free(partition->order);
+	free(partition);
+}
+
+void quadtree_partition_entities(const QuadTree *qtree, QuadTreePartition *partition, const Entity *entities) {
+	const AABB boundary = quadtree_get_boundary(qtree);
+	// the code goes in the upper half of each key and the entity index in
+	// the lower half, so sorting the keys by their upper half gives the order
+	uint64_t *keys = partition->keys;
+	uint64_t *scratch = partition->scratch;
+	for (int i = 0; i < partition->entity_count; ++i) {
+		uint code = morton_interleave(
+			quadtree_partition_quantize(entities[i].position.x, boundary.min.x, boundary.max.x),
+			quadtree_partition_quantize(entities[i].position.y, boundary.min.y, boundary.max.y),
+			QT_PARTITION_BITS
+		);
+		keys[i] = (uint64_t)code << 32 | i;
+	}
+	// LSD radix sort a byte at a time, an even number of passes leaves the
+	// result back in the keys array
+	for (int shift = 32; shift < 64; shift += 8) {
+		uint counts[257] = {0};
+		for (int i = 0; i < partition->entity_count; ++i) {
+			counts[((keys[i] >> shift) & 0xff) + 1]++;
+		}
+		for (int i = 0; i < 256; ++i) {
+			counts[i + 1] += counts[i];
+		}
+		for (int i = 0; i < partition->entity_count; ++i) {
+			scratch[counts[(keys[i] >> shift) & 0xff]++] = keys[i];
+		}
+		uint64_t *swap = keys;
+		keys = scratch;
+		scratch = swap;
+	}
+	for (int i = 0; i < partition->entity_count; ++i) {
+		partition->order[i] = (uint)keys[i];
+	}
 }
 
-void quadtree_entities_circle_intersecting_entity_circle(const QuadTree *qtree, const Entity *circle, DynamicArray *results) {
-	quadtree_node_entities_intersecting_entity(qtree, 0, circle, results, _aabb_intersects_entity_circle, _entity_circle_intersects_entity_circle);
+// Splits the partition order into one contiguous run per worker, balanced by
+// entity count
+const uint *quadtree_partition_get_range(const QuadTreePartition *partition, uint worker, uint worker_count, uint *count) {
+	const uint first = (uint64_t)partition->entity_count * worker / worker_count;
+	*count = (uint64_t)partition->entity_count * (worker + 1) / worker_count - first;
+	return &partition->order[first];
 }
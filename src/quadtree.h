@@ -1,10 +1,14 @@
 #ifndef QUADTREE_H
 #define QUADTREE_H
 
+#include <stddef.h>
+
 #include "util.h"
 
 typedef struct QuadTree QuadTree;
 
+typedef struct QuadTreePartition QuadTreePartition;
+
 QuadTree *quadtree_new(const AABB *boundary);
 
 void quadtree_clear(QuadTree *qtree);
@@ -13,16 +17,35 @@ void quadtree_free(QuadTree *qtree);
 
 uint quadtree_get_size(QuadTree *qtree);
 
-uint quadtree_add_entities_rect(QuadTree *qtree, Entity *rects, int count);
+size_t quadtree_get_memory_usage(const QuadTree *qtree);
+
+AABB quadtree_get_boundary(const QuadTree *qtree);
+
+// When enabled the root grows towards entities that land outside of it,
+// clearing the tree shrinks it back to the boundary it was created with
+void quadtree_set_auto_expand(QuadTree *qtree, bool auto_expand);
 
-uint quadtree_add_entities_circle(QuadTree *qtree, Entity *circles, int count);
+// Entities that could not be added are pushed to rejected unless it is NULL
+uint quadtree_add_entities(QuadTree *qtree, Entity *entities, int count, DynamicArray *rejected);
 
 void quadtree_rects_intersecting_rect(const QuadTree *qtree, const Rect *rect, DynamicArray *results);
 
 void quadtree_circles_intersecting_circle(const QuadTree *qtree, const Circle *circle, DynamicArray *results);
 
-void quadtree_entities_circle_intersecting_entity_circle(const QuadTree *qtree, const Entity *circle, DynamicArray *results);
+void quadtree_entities_intersecting_entity(const QuadTree *qtree, const Entity *entity, DynamicArray *results);
+
+// Same as the intersecting query but also returns entities within margin of the query shape
+void quadtree_entities_near_entity(const QuadTree *qtree, const Entity *entity, float margin, DynamicArray *results);
+
+// The order starts out as the identity, so ranges are plain index ranges
+// until the entities are first partitioned
+QuadTreePartition *quadtree_partition_new(uint entity_count);
+
+void quadtree_partition_free(QuadTreePartition *partition);
+
+void quadtree_partition_entities(const QuadTree *qtree, QuadTreePartition *partition, const Entity *entities);
 
-void quadtree_entities_rect_intersecting_entity_rect(const QuadTree *qtree, const Entity *rect, DynamicArray *results);
+// Returns the entity indices the worker owns and sets count to their number
+const uint *quadtree_partition_get_range(const QuadTreePartition *partition, uint worker, uint worker_count, uint *count);
 
 #endif
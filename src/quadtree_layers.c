@@ -0,0 +1,72 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include "quadtree.h"
+#include "quadtree_layers.h"
+#include "util.h"
+
+// Keeps immovable entities in their own tree that is built once and then
+// frozen, so per frame only the dynamic layer is cleared and rebuilt
+struct QuadTreeLayers {
+	bool static_frozen;
+	QuadTree *static_layer;
+	QuadTree *dynamic_layer;
+};
+
+QuadTreeLayers *quadtree_layers_new(const AABB *boundary) {
+	QuadTreeLayers *layers = malloc(sizeof(*layers));
+	if (layers == NULL) {
+		return NULL;
+	}
+	layers->static_layer = quadtree_new(boundary);
+	if (layers->static_layer == NULL) {
+		free(layers);
+		return NULL;
+	}
+	layers->dynamic_layer = quadtree_new(boundary);
+	if (layers->dynamic_layer == NULL) {
+		quadtree_free(layers->static_layer);
+		free(layers);
+		return NULL;
+	}
+	layers->static_frozen = false;
+	return layers;
+}
+
+void quadtree_layers_free(QuadTreeLayers *layers) {
+	quadtree_free(layers->static_layer);
+	quadtree_free(layers->dynamic_layer);
+	free(layers);
+}
+
+void quadtree_layers_set_auto_expand(QuadTreeLayers *layers, bool auto_expand) {
+	quadtree_set_auto_expand(layers->static_layer, auto_expand && !layers->static_frozen);
+	quadtree_set_auto_expand(layers->dynamic_layer, auto_expand);
+}
+
+uint quadtree_layers_add_static_entities(QuadTreeLayers *layers, Entity *entities, int count, DynamicArray *rejected) {
+	assert(!layers->static_frozen);
+	return quadtree_add_entities(layers->static_layer, entities, count, rejected);
+}
+
+void quadtree_layers_freeze_static(QuadTreeLayers *layers) {
+	layers->static_frozen = true;
+	quadtree_set_auto_expand(layers->static_layer, false);
+}
+
+void quadtree_layers_clear_dynamic(QuadTreeLayers *layers) {
+	quadtree_clear(layers->dynamic_layer);
+}
+
+uint quadtree_layers_add_dynamic_entities(QuadTreeLayers *layers, Entity *entities, int count, DynamicArray *rejected) {
+	return quadtree_add_entities(layers->dynamic_layer, entities, count, rejected);
+}
+
+void quadtree_layers_entities_intersecting_entity(const QuadTreeLayers *layers, const Entity *entity, QuadTreeLayer mask, DynamicArray *results) {
+	if (mask & QT_LAYER_STATIC) {
+		quadtree_entities_intersecting_entity(layers->static_layer, entity, results);
+	}
+	if (mask & QT_LAYER_DYNAMIC) {
+		quadtree_entities_intersecting_entity(layers->dynamic_layer, entity, results);
+	}
+}
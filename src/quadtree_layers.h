@@ -0,0 +1,34 @@
+#ifndef QUADTREE_LAYERS_H
+#define QUADTREE_LAYERS_H
+
+#include "quadtree.h"
+#include "util.h"
+
+typedef struct QuadTreeLayers QuadTreeLayers;
+
+typedef enum QuadTreeLayer {
+	QT_LAYER_STATIC = 1 << 0,
+	QT_LAYER_DYNAMIC = 1 << 1,
+	QT_LAYER_ALL = QT_LAYER_STATIC | QT_LAYER_DYNAMIC,
+} QuadTreeLayer;
+
+QuadTreeLayers *quadtree_layers_new(const AABB *boundary);
+
+void quadtree_layers_free(QuadTreeLayers *layers);
+
+void quadtree_layers_set_auto_expand(QuadTreeLayers *layers, bool auto_expand);
+
+// The static layer can only be added to until it is frozen
+uint quadtree_layers_add_static_entities(QuadTreeLayers *layers, Entity *entities, int count, DynamicArray *rejected);
+
+void quadtree_layers_freeze_static(QuadTreeLayers *layers);
+
+void quadtree_layers_clear_dynamic(QuadTreeLayers *layers);
+
+uint quadtree_layers_add_dynamic_entities(QuadTreeLayers *layers, Entity *entities, int count, DynamicArray *rejected);
+
+// Only the layers set in the mask are searched, so static entities can pass
+// QT_LAYER_DYNAMIC to skip static versus static pairs
+void quadtree_layers_entities_intersecting_entity(const QuadTreeLayers *layers, const Entity *entity, QuadTreeLayer mask, DynamicArray *results);
+
+#endif
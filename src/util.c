@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <math.h>
 #include <stdlib.h>
 
@@ -26,6 +27,10 @@ float clamp_float(float value, float min, float max) {
 	return (v > max) ? max : v;
 }
 
+bool shape_type_is_valid(ShapeType type) {
+	return type > SHAPE_NONE && type < SHAPE_COUNT;
+}
+
 Vec2 vec2_add(const Vec2 *a, const Vec2 *b) {
 	return (Vec2){
 		.x = a->x + b->x,
@@ -98,6 +103,34 @@ AABB aabb_get_from_entity_rect(const Entity *rect) {
 	};
 }
 
+AABB aabb_get_from_entity_circle(const Entity *circle) {
+	return (AABB){
+		.min = {
+			.x = circle->position.x - circle->shape.circle.radius,
+			.y = circle->position.y - circle->shape.circle.radius,
+		},
+		.max = {
+			.x = circle->position.x + circle->shape.circle.radius,
+			.y = circle->position.y + circle->shape.circle.radius,
+		},
+	};
+}
+
+AABB aabb_get_from_entity(const Entity *entity) {
+	assert(shape_type_is_valid(entity->type));
+	switch (entity->type) {
+	case SHAPE_RECT:
+		return aabb_get_from_entity_rect(entity);
+	case SHAPE_CIRCLE:
+		return aabb_get_from_entity_circle(entity);
+	case SHAPE_NONE:
+	case SHAPE_COUNT:
+		break;
+	}
+	// an untagged entity has no bounds, NaN never intersects or fits anything
+	return (AABB){{NAN, NAN}, {NAN, NAN}};
+}
+
 bool dynamic_array_init(DynamicArray *array) {
 	void **new_array = malloc(sizeof(*new_array) * ARRAY_DEFAULT_CAPACITY);
 	if (new_array == NULL) {
@@ -152,6 +185,16 @@ bool aabb_intersects_aabb(const AABB *a, const AABB *b) {
 			a->max.y > b->min.y && a->min.y < b->max.y);
 }
 
+bool aabb_contains_aabb(const AABB *outer, const AABB *inner) {
+	return (inner->min.x >= outer->min.x && inner->max.x <= outer->max.x &&
+			inner->min.y >= outer->min.y && inner->max.y <= outer->max.y);
+}
+
+bool aabb_is_finite(const AABB *aabb) {
+	return (isfinite(aabb->min.x) && isfinite(aabb->max.x) &&
+			isfinite(aabb->min.y) && isfinite(aabb->max.y));
+}
+
 bool aabb_intersects_entity_rect(const AABB *aabb, const Entity *rect) {
 	AABB aabb_b = aabb_get_from_entity_rect(rect);
 	return aabb_intersects_aabb(aabb, &aabb_b);
@@ -168,3 +211,25 @@ bool entity_rect_intersects_entity_rect(const Entity *a, const Entity *b) {
 	AABB aabb_b = aabb_get_from_entity_rect(b);
 	return aabb_intersects_aabb(&aabb_a, &aabb_b);
 }
+
+bool entity_circle_intersects_entity_rect(const Entity *circle, const Entity *rect) {
+	AABB aabb = aabb_get_from_entity_rect(rect);
+	return aabb_intersects_entity_circle(&aabb, circle);
+}
+
+bool entity_intersects_entity(const Entity *a, const Entity *b) {
+	assert(shape_type_is_valid(a->type) && shape_type_is_valid(b->type));
+	if (!shape_type_is_valid(a->type) || !shape_type_is_valid(b->type)) {
+		return false;
+	}
+	if (a->type == SHAPE_RECT && b->type == SHAPE_RECT) {
+		return entity_rect_intersects_entity_rect(a, b);
+	}
+	if (a->type == SHAPE_RECT) {
+		return entity_circle_intersects_entity_rect(b, a);
+	}
+	if (b->type == SHAPE_RECT) {
+		return entity_circle_intersects_entity_rect(a, b);
+	}
+	return entity_circle_intersects_entity_circle(a, b);
+}
@@ -29,9 +29,19 @@ typedef struct Circle {
 	float radius;
 } Circle;
 
+typedef enum ShapeType {
+	// zero is invalid so a zeroed entity without a type is caught instead of
+	// silently being treated as a rect
+	SHAPE_NONE,
+	SHAPE_RECT,
+	SHAPE_CIRCLE,
+	SHAPE_COUNT,
+} ShapeType;
+
 typedef struct Entity {
 	Vec2 position;
 	Vec2 velocity;
+	ShapeType type;
 	union {
 		Rect rect;
 		Circle circle;
@@ -44,6 +54,10 @@ typedef struct DynamicArray {
 	void **array;
 } DynamicArray;
 
+float clamp_float(float value, float min, float max);
+
+bool shape_type_is_valid(ShapeType type);
+
 Vec2 vec2_add(const Vec2 *a, const Vec2 *b);
 
 Vec2 vec2_subtract(const Vec2 *a, const Vec2 *b);
@@ -64,6 +78,16 @@ float vec2_magnitude_squared(const Vec2 *vec);
 
 Vec2 aabb_get_center(const AABB *rect);
 
+AABB aabb_get_from_entity_rect(const Entity *rect);
+
+AABB aabb_get_from_entity_circle(const Entity *circle);
+
+AABB aabb_get_from_entity(const Entity *entity);
+
+bool aabb_contains_aabb(const AABB *outer, const AABB *inner);
+
+bool aabb_is_finite(const AABB *aabb);
+
 bool aabb_intersects_entity_rect(const AABB *aabb, const Entity *rect);
 
 bool aabb_intersects_entity_circle(const AABB *aabb, const Entity *rect);
@@ -72,6 +96,10 @@ bool entity_circle_intersects_entity_circle(const Entity *a, const Entity *b);
 
 bool entity_rect_intersects_entity_rect(const Entity *a, const Entity *b);
 
+bool entity_circle_intersects_entity_rect(const Entity *circle, const Entity *rect);
+
+bool entity_intersects_entity(const Entity *a, const Entity *b);
+
 bool dynamic_array_init(DynamicArray *array);
 
 bool dynamic_array_push_back(DynamicArray *array, void *value);